@@ -1,8 +1,16 @@
+#include "BulkOutputBuffer.hpp"
+#include "Daemon.hpp"
+#include "Jit.hpp"
 #include "Setup.hpp"
 #include "math/Common.hpp"
 
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <random>
 #include <regex>
 #include <string>
 #include <unordered_map>
@@ -11,6 +19,10 @@
 #include <boost/format.hpp>
 #include <boost/program_options.hpp>
 
+#include <unistd.h>
+
+extern char** environ;
+
 static const std::unordered_map<Associativity, std::string> associativityNameMap = {
     {Associativity::Left, "Left"},
     {Associativity::Right, "Right"},
@@ -74,6 +86,101 @@ void resolveEnvironmentVariables(std::vector<std::string>& result)
     result.push_back("TRTBL_JUXTA");
     result.push_back(pTmp);
   }
+
+  if((pTmp = std::getenv("TRTBL_JIT")) != nullptr)
+  {
+    result.push_back("TRTBL_JIT");
+    result.push_back(pTmp);
+  }
+
+  if((pTmp = std::getenv("TRTBL_JIT_CHECK")) != nullptr)
+  {
+    result.push_back("TRTBL_JIT_CHECK");
+    result.push_back(pTmp);
+  }
+
+  if((pTmp = std::getenv("TRTBL_BULK")) != nullptr)
+  {
+    result.push_back("TRTBL_BULK");
+    result.push_back(pTmp);
+  }
+}
+
+// Only variables with this prefix are forwarded to a daemon, where they replace those the daemon was started with
+static const char environmentVariablePrefix[] = "TRTBL_";
+static const char clientOption[]              = "--client";
+static const char serveOption[]               = "--serve";
+
+static bool isOption(const char* arg, const char* option)
+{
+  const auto length = std::strlen(option);
+  return std::strncmp(arg, option, length) == 0 && (arg[length] == '\0' || arg[length] == '=');
+}
+
+/*
+ * Returns the socket to forward this invocation to, from "--client SOCKET", "--client=SOCKET" or TRTBL_SOCKET, or nullptr if not a client.
+ * Only scans the raw arguments so that a client never has to initialize or run the option parser. A daemon being started is never a client.
+ */
+static const char* findClientSocket(int argc, char* argv[])
+{
+  const char* pResult = nullptr;
+  for(int i = 1; i < argc && std::strcmp(argv[i], "--") != 0; i++)
+  {
+    if(isOption(argv[i], serveOption))
+    {
+      return nullptr;
+    }
+
+    if(isOption(argv[i], clientOption))
+    {
+      const char* pValue = argv[i] + std::strlen(clientOption);
+      pResult            = (*pValue == '=') ? pValue + 1 : (i + 1 < argc) ? argv[++i] : nullptr;
+    }
+  }
+
+  if(pResult == nullptr)
+  {
+    pResult = std::getenv("TRTBL_SOCKET");
+  }
+
+  return (pResult != nullptr && *pResult != '\0') ? pResult : nullptr;
+}
+
+static std::vector<std::string> getForwardedEnvironmentVariables()
+{
+  std::vector<std::string> result;
+  for(char** pEntry = environ; *pEntry != nullptr; pEntry++)
+  {
+    if(std::strncmp(*pEntry, environmentVariablePrefix, sizeof(environmentVariablePrefix) - 1u) == 0)
+    {
+      result.push_back(*pEntry);
+    }
+  }
+
+  return result;
+}
+
+static void setForwardedEnvironmentVariables(const std::vector<std::string>& envs)
+{
+  std::vector<std::string> names;
+  for(const auto& entry : getForwardedEnvironmentVariables())
+  {
+    names.push_back(entry.substr(0u, entry.find('=')));
+  }
+
+  for(const auto& name : names)
+  {
+    unsetenv(name.c_str());
+  }
+
+  for(const auto& entry : envs)
+  {
+    const auto separator = entry.find('=');
+    if(separator != std::string::npos)
+    {
+      setenv(entry.substr(0u, separator).c_str(), entry.c_str() + separator + 1u, 1);
+    }
+  }
 }
 
 template<typename InputIterator, typename T>
@@ -104,6 +211,57 @@ static void assignInput(const std::list<unsigned int>& premutations)
   }
 }
 
+static void assignInput(std::uint64_t row)
+{
+  auto bit = defaultUninitializedVariableCache.size();
+  for(auto& variable : defaultUninitializedVariableCache)
+  {
+    variable.get()->As<DefaultVariableType*>()->SetValue(static_cast<bool>((row >> --bit) & 1u));
+  }
+}
+
+template<typename QueueType>
+static std::unique_ptr<JitExpression> compileExpression(const std::string& expression, const QueueType& queue, ExpressionParserBase& expressionParser)
+{
+  std::vector<const void*> tokens;
+  for(auto tmpQueue = queue; !tmpQueue.empty(); tmpQueue.pop())
+  {
+    tokens.push_back(dynamic_cast<const void*>(&*tmpQueue.front()));
+  }
+
+  std::vector<const void*> variables;
+  for(const auto& variable : defaultUninitializedVariableCache)
+  {
+    variables.push_back(dynamic_cast<const void*>(variable.get()));
+  }
+
+  auto result = JitExpression::Compile(tokens, variables);
+  if(result == nullptr || options.jit_check == 0u)
+  {
+    return result;
+  }
+
+  const std::uint64_t rowCount = std::uint64_t(1u) << variables.size();
+  std::mt19937_64 generator(std::random_device {}());
+  std::uniform_int_distribution<std::uint64_t> distribution(0u, rowCount - 1u);
+  for(std::size_t i = 0u; i < options.jit_check; i++)
+  {
+    const auto row = distribution(generator);
+    assignInput(row);
+
+    auto tmpQueue        = queue;
+    const bool expected  = expressionParser.Evaluate(tmpQueue)->As<DefaultValueType*>()->GetValue<DefaultArithmeticType>();
+    const bool jitResult = ((result->EvaluateBlock(row >> 6u) >> (row & 63u)) & 1u) != 0u;
+    if(jitResult != expected)
+    {
+      std::cerr << (boost::format("*** Warning: JIT mismatch at row %1% of \"%2%\", falling back to the interpreter") % row % expression) << std::endl;
+      return nullptr;
+    }
+  }
+
+  return result;
+}
+
 static void clearVariableCache()
 {
   while(!defaultUninitializedVariableCache.empty())
@@ -139,12 +297,34 @@ static void evaluate(const std::string& expression, ExpressionParserBase& expres
     columnAlignment.push_back(std::max(iter->get()->GetIdentifier().length(), maxSubLen));
     std::cout << iter->get()->GetIdentifier() << std::endl;
 
+    std::unique_ptr<JitExpression> jit;
+    if(options.jit && defaultUninitializedVariableCache.size() <= JitExpression::GetMaxVariableCount())
+    {
+      jit = compileExpression(expression, queue, expressionParser);
+    }
+
+    std::uint64_t row   = 0u;
+    std::uint64_t block = 0u;
     do
     {
-      assignInput(premutations);
+      bool result;
+      if(jit != nullptr)
+      {
+        if((row & 63u) == 0u)
+        {
+          block = jit->EvaluateBlock(row >> 6u);
+        }
 
-      auto tmpQueue = queue;
-      auto result   = DefaultValueType(expressionParser.Evaluate(tmpQueue)->As<DefaultValueType*>()->GetValue<DefaultArithmeticType>());
+        result = ((block >> (row & 63u)) & 1u) != 0u;
+        row++;
+      }
+      else
+      {
+        assignInput(premutations);
+
+        auto tmpQueue = queue;
+        result        = expressionParser.Evaluate(tmpQueue)->As<DefaultValueType*>()->GetValue<DefaultArithmeticType>();
+      }
 
       const auto last = std::prev(premutations.cend());
       auto iter       = premutations.cbegin();
@@ -155,8 +335,7 @@ static void evaluate(const std::string& expression, ExpressionParserBase& expres
         std::cout << (boost::format(lineFormat) % ((*iter != 0u) ? options.tsub : options.fsub) % options.isep);
       }
       std::string lineFormat = (boost::format("%%|1$-%1%|%%|2$-%2%|%%|3$|") % (*alignIter + options.opad_a) % (options.opad_b + 1u)).str();
-      std::cout << (boost::format(lineFormat) % ((*iter != 0u) ? options.tsub : options.fsub) % options.osep %
-                    (result.GetValue<DefaultArithmeticType>() ? options.tsub : options.fsub))
+      std::cout << (boost::format(lineFormat) % ((*iter != 0u) ? options.tsub : options.fsub) % options.osep % (result ? options.tsub : options.fsub))
                 << std::endl;
     } while(cartesianProduct(premutations.begin(), premutations.end(), 0u, 1u));
 
@@ -304,6 +483,9 @@ static void printOptions()
   std::cerr << (boost::format("  %|1$-26|%|2$|") % "Output padding (Postfix)" % options.opad_b) << std::endl;
   std::cerr << (boost::format("  %|1$-26|%|2$|") % "Lexicographical variable sorting" % options.sort) << std::endl;
   std::cerr << (boost::format("  %|1$-26|%|2$|") % "Juxtaposition precedence" % options.jpo_precedence) << std::endl;
+  std::cerr << (boost::format("  %|1$-26|%|2$|") % "Native compilation" % options.jit) << std::endl;
+  std::cerr << (boost::format("  %|1$-26|%|2$|") % "Native compilation checks" % options.jit_check) << std::endl;
+  std::cerr << (boost::format("  %|1$-26|%|2$|") % "Bulk output" % options.bulk) << std::endl;
   std::cerr << std::endl;
 }
 
@@ -311,14 +493,15 @@ static void printVersion() { std::cout << (boost::format("%1% v%2%") % PROJECT_N
 
 static void printUsage(const boost::program_options::options_description& desc)
 {
-  std::cerr << (boost::format("%1% -[xtfsSpPuUjlvVh] expr...") % PROJECT_EXECUTABLE) << std::endl;
+  std::cerr << (boost::format("%1% -[xtfsSpPuUjJBlvVh] expr...") % PROJECT_EXECUTABLE) << std::endl;
   std::cerr << desc << std::endl;
 }
 
-int main(int argc, char* argv[])
+static void parseOptions(const std::vector<std::string>& envs,
+                         const std::vector<std::string>& args,
+                         boost::program_options::options_description& namedArgDescs,
+                         boost::program_options::variables_map& argVariableMap)
 {
-  std::vector<std::string> envs;
-  resolveEnvironmentVariables(envs);
   boost::program_options::options_description namedEnvDescs;
   namedEnvDescs.add_options()("TRTBL_TRUE", boost::program_options::value<std::string>(&options.tsub)->default_value(defaultOptions.tsub));
   namedEnvDescs.add_options()("TRTBL_FALSE", boost::program_options::value<std::string>(&options.fsub)->default_value(defaultOptions.fsub));
@@ -334,6 +517,9 @@ int main(int argc, char* argv[])
       boost::program_options::value<int>(&options.jpo_precedence)->default_value(defaultOptions.jpo_precedence)->notifier([](int value) {
         options.jpo_precedence = Math::Sign(value);
       }));
+  namedEnvDescs.add_options()("TRTBL_JIT", boost::program_options::value<bool>(&options.jit)->default_value(defaultOptions.jit));
+  namedEnvDescs.add_options()("TRTBL_JIT_CHECK", boost::program_options::value<std::size_t>(&options.jit_check)->default_value(defaultOptions.jit_check));
+  namedEnvDescs.add_options()("TRTBL_BULK", boost::program_options::value<bool>(&options.bulk)->default_value(defaultOptions.bulk));
   boost::program_options::variables_map envVariableMap;
   boost::program_options::store(boost::program_options::command_line_parser(envs)
                                     .options(namedEnvDescs)
@@ -342,7 +528,6 @@ int main(int argc, char* argv[])
                                 envVariableMap);
   boost::program_options::notify(envVariableMap);
 
-  boost::program_options::options_description namedArgDescs("Options");
   namedArgDescs.add_options()("expr,x", boost::program_options::value<std::vector<std::string>>(), "Add an expression");
   namedArgDescs.add_options()("true,t", boost::program_options::value<std::string>(&options.tsub), "Set \'true\' substitution");
   namedArgDescs.add_options()("false,f", boost::program_options::value<std::string>(&options.fsub), "Set \'false\' substitution");
@@ -356,27 +541,40 @@ int main(int argc, char* argv[])
   namedArgDescs.add_options()("juxta,j",
                               boost::program_options::value<int>()->notifier([](int value) { options.jpo_precedence = Math::Sign(value); }),
                               "Set juxtaposition operator precedence (-1, 0, 1)");
+  namedArgDescs.add_options()("jit,J", boost::program_options::value<bool>(&options.jit)->implicit_value(true), "Compile expressions to native code");
+  namedArgDescs.add_options()("jit_check",
+                              boost::program_options::value<std::size_t>(&options.jit_check)->implicit_value(1024u),
+                              "Verify compiled expressions against the interpreter on random rows");
+  namedArgDescs.add_options()("bulk,B",
+                              boost::program_options::value<bool>(&options.bulk)->implicit_value(true),
+                              "Write output in large blocks from a separate thread");
   namedArgDescs.add_options()("list,l", boost::program_options::value<std::string>()->implicit_value(".*"), "List available operators/variables");
+  namedArgDescs.add_options()("serve", boost::program_options::value<std::string>(), "Serve requests on a local socket");
+  namedArgDescs.add_options()("client", boost::program_options::value<std::string>(), "Forward this invocation to a local socket (Overrides TRTBL_SOCKET)");
   namedArgDescs.add_options()("verbose,v", "Enable verbose mode");
   namedArgDescs.add_options()("version,V", "Print version");
   namedArgDescs.add_options()("help,h", "Print usage");
   boost::program_options::positional_options_description positionalArgDescs;
   positionalArgDescs.add("expr", -1);
-  boost::program_options::variables_map argVariableMap;
-  boost::program_options::store(boost::program_options::command_line_parser(argc, argv).options(namedArgDescs).positional(positionalArgDescs).run(),
+  boost::program_options::store(boost::program_options::command_line_parser(args).options(namedArgDescs).positional(positionalArgDescs).run(),
                                 argVariableMap);
   boost::program_options::notify(argVariableMap);
+}
 
+static int run(const boost::program_options::options_description& namedArgDescs,
+               const boost::program_options::variables_map& argVariableMap,
+               ExpressionParserBase& expressionParser)
+{
   if(argVariableMap.count("help") > 0u)
   {
     printUsage(namedArgDescs);
-    std::exit(EXIT_SUCCESS);
+    return EXIT_SUCCESS;
   }
 
   if(argVariableMap.count("version") > 0u)
   {
     printVersion();
-    std::exit(EXIT_SUCCESS);
+    return EXIT_SUCCESS;
   }
 
   if(argVariableMap.count("verbose") > 0u)
@@ -384,13 +582,19 @@ int main(int argc, char* argv[])
     printOptions();
   }
 
-  ExpressionParserBase expressionParser;
-  InitTruthTable(expressionParser);
+  InitJuxtaposition(expressionParser);
 
   if(argVariableMap.count("list") > 0u)
   {
     list(argVariableMap["list"].as<const std::string&>());
-    std::exit(EXIT_SUCCESS);
+    return EXIT_SUCCESS;
+  }
+
+  // Replaces the buffer of std::cout until the end of this scope
+  std::unique_ptr<BulkOutputBuffer> pBulkOutputBuffer;
+  if(options.bulk)
+  {
+    pBulkOutputBuffer = std::make_unique<BulkOutputBuffer>(std::cout, STDOUT_FILENO);
   }
 
   bool hasPipedData = std::cin.rdbuf()->in_avail() != -1 && isatty(fileno(stdin)) == 0;
@@ -406,7 +610,7 @@ int main(int argc, char* argv[])
   if(argVariableMap.count("expr") == 0u && !hasPipedData)
   {
     std::cerr << "*** Error: No expression specified" << std::endl;
-    std::exit(EXIT_FAILURE);
+    return EXIT_FAILURE;
   }
 
   if(argVariableMap.count("expr") > 0u)
@@ -418,5 +622,52 @@ int main(int argc, char* argv[])
     }
   }
 
-  std::exit(EXIT_SUCCESS);
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+  // Skips all initialization and option parsing, the daemon parses the forwarded environment variables and arguments itself
+  const char* pClientSocket = findClientSocket(argc, argv);
+  if(pClientSocket != nullptr)
+  {
+    std::exit(RequestDaemon(pClientSocket, getForwardedEnvironmentVariables(), std::vector<std::string>(argv + 1, argv + argc)));
+  }
+
+  std::vector<std::string> envs;
+  resolveEnvironmentVariables(envs);
+  const std::vector<std::string> args(argv + 1, argv + argc);
+  boost::program_options::options_description namedArgDescs("Options");
+  boost::program_options::variables_map argVariableMap;
+  parseOptions(envs, args, namedArgDescs, argVariableMap);
+
+  ExpressionParserBase expressionParser;
+  InitTruthTable(expressionParser);
+
+  if(argVariableMap.count("serve") > 0u)
+  {
+    std::exit(ServeDaemon(argVariableMap["serve"].as<const std::string&>(),
+                          [&expressionParser](const std::vector<std::string>& forwardedEnvs, const std::vector<std::string>& args) {
+                            setForwardedEnvironmentVariables(forwardedEnvs);
+                            std::vector<std::string> envs;
+                            resolveEnvironmentVariables(envs);
+                            boost::program_options::options_description namedArgDescs("Options");
+                            boost::program_options::variables_map argVariableMap;
+                            parseOptions(envs, args, namedArgDescs, argVariableMap);
+                            return run(namedArgDescs, argVariableMap, expressionParser);
+                          }));
+  }
+
+  // Unwinding out of run() writes out everything already evaluated when output is buffered
+  int status = EXIT_FAILURE;
+  try
+  {
+    status = run(namedArgDescs, argVariableMap, expressionParser);
+  }
+  catch(const std::exception& e)
+  {
+    std::cerr << (boost::format("*** Error: %1%") % e.what()) << std::endl;
+  }
+
+  std::exit(status);
 }
@@ -0,0 +1,283 @@
+#include "BulkOutputBuffer.hpp"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static const std::size_t bufferSize     = 2u * 1024u * 1024u;
+static const std::size_t pipeBufferSize = 1024u * 1024u;
+static const std::size_t hugePageSize   = 2u * 1024u * 1024u;
+static const std::chrono::milliseconds idleTimeout(50);
+
+// Explicit huge pages are not used for spliced buffers, which are dropped with MADV_DONTNEED after each splice
+static char* allocateBuffers(std::size_t size, bool allowHugeTlb)
+{
+  void* pMemory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if(allowHugeTlb && size % hugePageSize == 0u)
+  {
+    pMemory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+
+  if(pMemory == MAP_FAILED)
+  {
+    pMemory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(pMemory == MAP_FAILED)
+    {
+      return nullptr;
+    }
+
+#ifdef MADV_HUGEPAGE
+    madvise(pMemory, size, MADV_HUGEPAGE);
+#endif
+  }
+
+  return static_cast<char*>(pMemory);
+}
+
+// A larger pipe lets the reader fall behind further before vmsplice blocks
+static bool resizePipe(int descriptor)
+{
+#if defined(__linux__) && defined(F_SETPIPE_SZ)
+  struct stat info;
+  if(fstat(descriptor, &info) != 0 || !S_ISFIFO(info.st_mode))
+  {
+    return false;
+  }
+
+  fcntl(descriptor, F_SETPIPE_SZ, static_cast<int>(pipeBufferSize));
+  return true;
+#else
+  static_cast<void>(descriptor);
+  return false;
+#endif
+}
+
+BulkOutputBuffer::BulkOutputBuffer(std::ostream& stream, int descriptor)
+    : m_Stream(stream)
+    , m_pPreviousBuffer(nullptr)
+    , m_Descriptor(descriptor)
+    , m_IsPipe(false)
+    , m_pMemory(nullptr)
+    , m_MemorySize(0u)
+    , m_BufferSize(bufferSize)
+    , m_Current(0u)
+    , m_States {BufferState::Free, BufferState::Free}
+    , m_Lengths {0u, 0u}
+    , m_Offsets {0u, 0u}
+    , m_SyncedLength(0u)
+    , m_SyncCount(0u)
+    , m_IsClosing(false)
+    , m_HasFailed(false)
+{
+  m_IsPipe     = resizePipe(descriptor);
+  m_MemorySize = bufferCount * m_BufferSize;
+  m_pMemory    = allocateBuffers(m_MemorySize, !m_IsPipe);
+  if(m_pMemory == nullptr)
+  {
+    // Leaves the stream untouched
+    return;
+  }
+
+  setp(m_pMemory, m_pMemory + m_BufferSize);
+  m_Writer = std::thread(&BulkOutputBuffer::writeLoop, this);
+
+  m_Stream.flush();
+  m_pPreviousBuffer = m_Stream.rdbuf(this);
+}
+
+BulkOutputBuffer::~BulkOutputBuffer()
+{
+  if(m_pMemory == nullptr)
+  {
+    return;
+  }
+
+  m_Stream.rdbuf(m_pPreviousBuffer);
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const auto length = static_cast<std::size_t>(pptr() - pbase());
+    if(length > 0u && !m_HasFailed)
+    {
+      m_Lengths[m_Current] = length;
+      m_States[m_Current]  = BufferState::Filled;
+    }
+
+    m_IsClosing = true;
+  }
+  m_Condition.notify_all();
+  m_Writer.join();
+
+  munmap(m_pMemory, m_MemorySize);
+}
+
+BulkOutputBuffer::int_type BulkOutputBuffer::overflow(int_type c)
+{
+  if(!submit())
+  {
+    return traits_type::eof();
+  }
+
+  if(!traits_type::eq_int_type(c, traits_type::eof()))
+  {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+
+  return traits_type::not_eof(c);
+}
+
+// Only marks what has been written so far as due, the writer picks it up once flushing has stopped for a while
+int BulkOutputBuffer::sync()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  const bool isIdle = m_SyncedLength == m_Offsets[m_Current];
+  m_SyncedLength    = static_cast<std::size_t>(pptr() - pbase());
+  m_SyncCount++;
+  if(isIdle)
+  {
+    m_Condition.notify_all();
+  }
+
+  return m_HasFailed ? -1 : 0;
+}
+
+bool BulkOutputBuffer::submit()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  const auto length = static_cast<std::size_t>(pptr() - pbase());
+  if(length > 0u)
+  {
+    m_Lengths[m_Current] = length;
+    m_States[m_Current]  = BufferState::Filled;
+    m_Condition.notify_all();
+
+    m_Current      = (m_Current + 1u) % bufferCount;
+    m_SyncedLength = 0u;
+    m_Condition.wait(lock, [this]() { return m_States[m_Current] == BufferState::Free || m_HasFailed; });
+  }
+
+  if(m_HasFailed)
+  {
+    return false;
+  }
+
+  char* pBuffer = m_pMemory + m_Current * m_BufferSize;
+  setp(pBuffer, pBuffer + m_BufferSize);
+  return true;
+}
+
+void BulkOutputBuffer::writeLoop()
+{
+  std::size_t index = 0u;
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  while(true)
+  {
+    const auto isSynced = [this, &index]() { return index == m_Current && m_SyncedLength > m_Offsets[index]; };
+    m_Condition.wait(lock, [this, &index, &isSynced]() { return m_States[index] == BufferState::Filled || m_IsClosing || isSynced(); });
+    if(m_States[index] != BufferState::Filled)
+    {
+      if(m_IsClosing)
+      {
+        break;
+      }
+
+      // Waits until flushing has stopped, then writes the flushed part of the buffer which is still being filled
+      const auto syncCount = m_SyncCount;
+      if(m_Condition.wait_for(lock, idleTimeout, [this, &index, syncCount]() {
+           return m_States[index] == BufferState::Filled || m_IsClosing || m_SyncCount != syncCount;
+         }))
+      {
+        continue;
+      }
+
+      const auto offset = m_Offsets[index];
+      const auto length = m_SyncedLength;
+      lock.unlock();
+      const bool isWritten = writeBuffer(m_pMemory + index * m_BufferSize + offset, length - offset, false);
+      lock.lock();
+
+      if(!isWritten)
+      {
+        m_HasFailed = true;
+        m_Condition.notify_all();
+        break;
+      }
+
+      m_Offsets[index] = length;
+      continue;
+    }
+
+    char* pBuffer     = m_pMemory + index * m_BufferSize;
+    const auto offset = m_Offsets[index];
+    const auto length = m_Lengths[index];
+    lock.unlock();
+    /*
+     * Spliced pages stay referenced by the pipe, and by anything the reader splices or tees them into, long after they left the pipe.
+     * Dropping them makes the next fill fault in fresh pages instead of changing data that is still referenced elsewhere.
+     */
+    const bool isWritten = writeBuffer(pBuffer + offset, length - offset, m_IsPipe) && (!m_IsPipe || madvise(pBuffer, length, MADV_DONTNEED) == 0);
+    lock.lock();
+
+    if(!isWritten)
+    {
+      m_HasFailed = true;
+      m_Condition.notify_all();
+      break;
+    }
+
+    m_States[index]  = BufferState::Free;
+    m_Offsets[index] = 0u;
+    m_Condition.notify_all();
+    index = (index + 1u) % bufferCount;
+  }
+}
+
+// Partially filled buffers are written with write(), splicing them would hand out pages which are still being written to
+bool BulkOutputBuffer::writeBuffer(char* pData, std::size_t length, bool isSpliced)
+{
+  while(length > 0u)
+  {
+    ssize_t count;
+#ifdef __linux__
+    if(isSpliced)
+    {
+      iovec io {pData, length};
+      count = vmsplice(m_Descriptor, &io, 1u, 0u);
+    }
+    else
+#endif
+    {
+      count = write(m_Descriptor, pData, length);
+    }
+
+    if(count < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        pollfd descriptor {m_Descriptor, POLLOUT, 0};
+        poll(&descriptor, 1u, -1);
+        continue;
+      }
+
+      return false;
+    }
+
+    pData += count;
+    length -= static_cast<std::size_t>(count);
+  }
+
+  return true;
+}
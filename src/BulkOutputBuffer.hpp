@@ -0,0 +1,66 @@
+#ifndef __BULKOUTPUTBUFFER_HPP__
+#define __BULKOUTPUTBUFFER_HPP__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+
+/*
+ * Stream buffer which replaces the buffer of a stream for its lifetime and writes to a file descriptor from a separate thread.
+ * Output is collected in two page aligned (huge pages if available) buffers, one being filled while the other is written.
+ * Pipes are fed with vmsplice, everything else with large write calls. Spliced pages are never written again, the buffer is backed by fresh
+ * pages afterwards. Flushing the stream does not write immediately, flushed output is written once nothing more has been flushed for a short while, or
+ * along with the rest of its buffer when it fills up first.
+ */
+class BulkOutputBuffer : public std::streambuf
+{
+  public:
+  BulkOutputBuffer(std::ostream& stream, int descriptor);
+  ~BulkOutputBuffer() override;
+
+  BulkOutputBuffer(const BulkOutputBuffer&) = delete;
+  BulkOutputBuffer& operator=(const BulkOutputBuffer&) = delete;
+
+  protected:
+  int_type overflow(int_type c) override;
+  int sync() override;
+
+  private:
+  enum class BufferState
+  {
+    Free,
+    Filled,
+  };
+
+  static constexpr std::size_t bufferCount = 2u;
+
+  bool submit();
+  void writeLoop();
+  bool writeBuffer(char* pData, std::size_t length, bool isSpliced);
+
+  std::ostream& m_Stream;
+  std::streambuf* m_pPreviousBuffer;
+  int m_Descriptor;
+  bool m_IsPipe;
+  char* m_pMemory;
+  std::size_t m_MemorySize;
+  std::size_t m_BufferSize;
+  std::size_t m_Current;
+
+  BufferState m_States[bufferCount];
+  std::size_t m_Lengths[bufferCount];
+  std::size_t m_Offsets[bufferCount];
+  std::size_t m_SyncedLength;
+  std::size_t m_SyncCount;
+  bool m_IsClosing;
+  bool m_HasFailed;
+  std::mutex m_Mutex;
+  std::condition_variable m_Condition;
+  std::thread m_Writer;
+};
+
+#endif // __BULKOUTPUTBUFFER_HPP__
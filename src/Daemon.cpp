@@ -0,0 +1,532 @@
+#include "Daemon.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const std::size_t forwardedDescriptorCount = 3u;
+static const char envFieldTag                     = 'E';
+static const char argFieldTag                     = 'A';
+
+// Bounds what a client can make a connection process buffer, and for how long it waits for the request to complete
+static const std::size_t maxRequestLength = 1024u * 1024u;
+static const std::chrono::seconds requestTimeout(5);
+
+// Responses consist of a tag telling how the handler terminated, followed by its exit status or signal number
+static const std::size_t statusLength        = 2u;
+static const unsigned char exitedStatusTag   = 'X';
+static const unsigned char signaledStatusTag = 'S';
+
+// A request being served, the daemon keeps its end of the connection to send the exit status of the process serving it
+struct DaemonRequest
+{
+  pid_t pid;
+  int connection;
+  int exitDescriptor;
+};
+
+static const int terminationSignals[] = {SIGINT, SIGTERM, SIGHUP};
+static char servedPath[sizeof(sockaddr_un::sun_path)];
+
+static void onTerminationSignal(int signal)
+{
+  unlink(servedPath);
+  std::signal(signal, SIG_DFL);
+  std::raise(signal);
+}
+
+static void setTerminationHandler(void (*handler)(int))
+{
+  for(auto signal : terminationSignals)
+  {
+    std::signal(signal, handler);
+  }
+}
+
+static int printError(const std::string& what)
+{
+  std::cerr << (boost::format("*** Error: %1%: %2%") % what % std::strerror(errno)) << std::endl;
+  return EXIT_FAILURE;
+}
+
+static bool makeAddress(const std::string& path, sockaddr_un& result)
+{
+  std::memset(&result, 0, sizeof(result));
+  result.sun_family = AF_UNIX;
+  if(path.empty() || path.length() >= sizeof(result.sun_path))
+  {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+
+  std::memcpy(result.sun_path, path.c_str(), path.length());
+  return true;
+}
+
+static bool writeAll(int fd, const char* data, std::size_t length)
+{
+  while(length > 0u)
+  {
+    ssize_t count = write(fd, data, length);
+    if(count < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+
+      return false;
+    }
+
+    data += count;
+    length -= static_cast<std::size_t>(count);
+  }
+
+  return true;
+}
+
+static bool readAll(int fd, std::string& result)
+{
+  char buffer[4096];
+  ssize_t count;
+  while((count = read(fd, buffer, sizeof(buffer))) != 0)
+  {
+    if(count < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+
+      return false;
+    }
+
+    result.append(buffer, static_cast<std::size_t>(count));
+  }
+
+  return true;
+}
+
+static void appendFields(std::string& result, char tag, const std::vector<std::string>& values)
+{
+  for(const auto& value : values)
+  {
+    result.push_back(tag);
+    result.append(value);
+    result.push_back('\0');
+  }
+}
+
+static void splitFields(const std::string& payload, std::vector<std::string>& envs, std::vector<std::string>& args)
+{
+  std::size_t begin = 0u;
+  std::size_t end;
+  while((end = payload.find('\0', begin)) != std::string::npos)
+  {
+    if(end > begin)
+    {
+      auto& target = (payload[begin] == envFieldTag) ? envs : args;
+      target.push_back(payload.substr(begin + 1u, end - begin - 1u));
+    }
+
+    begin = end + 1u;
+  }
+}
+
+static bool waitReadable(int fd, const std::chrono::steady_clock::time_point& deadline)
+{
+  while(true)
+  {
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    pollfd event {fd, POLLIN, 0};
+    const int count = (remaining > 0) ? poll(&event, 1u, static_cast<int>(remaining)) : 0;
+    if(count > 0)
+    {
+      return true;
+    }
+
+    if(count == 0)
+    {
+      errno = ETIMEDOUT;
+      return false;
+    }
+
+    if(errno != EINTR)
+    {
+      return false;
+    }
+  }
+}
+
+static bool receiveRequest(int connection, int (&descriptors)[forwardedDescriptorCount], std::string& payload)
+{
+  const auto deadline = std::chrono::steady_clock::now() + requestTimeout;
+  char buffer[4096];
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(descriptors))];
+  iovec io {buffer, sizeof(buffer)};
+  msghdr message {};
+  message.msg_iov        = &io;
+  message.msg_iovlen     = 1u;
+  message.msg_control    = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t count;
+  do
+  {
+    if(!waitReadable(connection, deadline))
+    {
+      return false;
+    }
+  } while((count = recvmsg(connection, &message, MSG_DONTWAIT)) < 0 && (errno == EINTR || errno == EAGAIN));
+  if(count <= 0)
+  {
+    return false;
+  }
+
+  const cmsghdr* pHeader = CMSG_FIRSTHDR(&message);
+  if(pHeader == nullptr || pHeader->cmsg_level != SOL_SOCKET || pHeader->cmsg_type != SCM_RIGHTS || pHeader->cmsg_len != CMSG_LEN(sizeof(descriptors)))
+  {
+    errno = EPROTO;
+    return false;
+  }
+
+  std::memcpy(descriptors, CMSG_DATA(pHeader), sizeof(descriptors));
+  payload.assign(buffer, static_cast<std::size_t>(count));
+  while(true)
+  {
+    if(!waitReadable(connection, deadline))
+    {
+      return false;
+    }
+
+    count = read(connection, buffer, sizeof(buffer));
+    if(count == 0)
+    {
+      return true;
+    }
+
+    if(count < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+
+      return false;
+    }
+
+    if(payload.length() + static_cast<std::size_t>(count) > maxRequestLength)
+    {
+      errno = EMSGSIZE;
+      return false;
+    }
+
+    payload.append(buffer, static_cast<std::size_t>(count));
+  }
+}
+
+[[noreturn]] static void runHandler(int (&descriptors)[forwardedDescriptorCount], const std::string& payload, const DaemonRequestHandlerType& handler)
+{
+  for(std::size_t i = 0u; i < forwardedDescriptorCount; i++)
+  {
+    dup2(descriptors[i], static_cast<int>(i));
+    close(descriptors[i]);
+  }
+
+  std::vector<std::string> envs;
+  std::vector<std::string> args;
+  splitFields(payload, envs, args);
+
+  int status = EXIT_FAILURE;
+  try
+  {
+    status = handler(envs, args);
+  }
+  catch(const std::exception& e)
+  {
+    std::cerr << (boost::format("*** Error: %1%") % e.what()) << std::endl;
+  }
+
+  std::cout.flush();
+  std::_Exit(status);
+}
+
+// Runs in the process forked for a connection
+[[noreturn]] static void handleConnection(int connection, const DaemonRequestHandlerType& handler)
+{
+  setTerminationHandler(SIG_DFL);
+
+  int descriptors[forwardedDescriptorCount];
+  std::string payload;
+  if(!receiveRequest(connection, descriptors, payload))
+  {
+    std::_Exit(EXIT_FAILURE);
+  }
+
+  close(connection);
+  runHandler(descriptors, payload, handler);
+}
+
+// Sends how the process serving a request terminated, the client may already be gone
+static void sendStatus(int connection, int result)
+{
+  unsigned char status[statusLength] = {exitedStatusTag, EXIT_FAILURE};
+  if(WIFSIGNALED(result))
+  {
+    status[0u] = signaledStatusTag;
+    status[1u] = static_cast<unsigned char>(WTERMSIG(result));
+  }
+  else if(WIFEXITED(result))
+  {
+    status[1u] = static_cast<unsigned char>(WEXITSTATUS(result));
+  }
+
+  while(send(connection, status, sizeof(status), MSG_NOSIGNAL) < 0 && errno == EINTR) {}
+}
+
+int ServeDaemon(const std::string& path, const DaemonRequestHandlerType& handler)
+{
+  sockaddr_un address;
+  if(!makeAddress(path, address))
+  {
+    return printError(path);
+  }
+
+  // Only a stale socket, which nothing is listening on anymore, is replaced
+  struct stat info;
+  if(lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+  {
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(probe < 0)
+    {
+      return printError("socket");
+    }
+
+    const bool isServed = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    const int error     = errno;
+    close(probe);
+    if(isServed)
+    {
+      std::cerr << (boost::format("*** Error: %1%: Already served by another daemon") % path) << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if(error == ECONNREFUSED)
+    {
+      unlink(path.c_str());
+    }
+  }
+
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(listener < 0)
+  {
+    return printError("socket");
+  }
+
+  if(bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+  {
+    close(listener);
+    return printError(path);
+  }
+
+  std::memcpy(servedPath, address.sun_path, sizeof(servedPath));
+  setTerminationHandler(onTerminationSignal);
+  if(listen(listener, SOMAXCONN) != 0)
+  {
+    close(listener);
+    unlink(servedPath);
+    return printError(path);
+  }
+
+  /*
+   * Each request is served by a single forked process. The daemon waits for it, which lets termination by a signal (e.g. SIGPIPE when the
+   * client's stdout is closed) be reported to the client, which then terminates the same way. The process is killed if the client goes away first.
+   * The write end of a request's exit pipe is only held by its process, so the pipe hangs up when the process terminates.
+   */
+  std::vector<DaemonRequest> requests;
+  std::vector<pollfd> events;
+  while(true)
+  {
+    events.assign(1u, {listener, POLLIN, 0});
+    for(const auto& request : requests)
+    {
+      events.push_back({request.exitDescriptor, 0, 0});
+      events.push_back({request.connection, 0, 0});
+    }
+
+    if(poll(events.data(), events.size(), -1) < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+
+      printError("poll");
+      break;
+    }
+
+    for(std::size_t i = requests.size(); i-- > 0u;)
+    {
+      const auto& request = requests[i];
+      const bool isExited = (events[1u + i * 2u].revents & POLLHUP) != 0;
+      const bool isHungUp = (events[2u + i * 2u].revents & (POLLHUP | POLLERR)) != 0;
+      if(!isExited && !isHungUp)
+      {
+        continue;
+      }
+
+      if(!isExited)
+      {
+        kill(request.pid, SIGKILL);
+      }
+
+      int result;
+      while(waitpid(request.pid, &result, 0) < 0 && errno == EINTR) {}
+      sendStatus(request.connection, result);
+      close(request.connection);
+      close(request.exitDescriptor);
+      requests.erase(requests.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+
+    if((events[0u].revents & POLLIN) == 0)
+    {
+      continue;
+    }
+
+    int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if(connection < 0)
+    {
+      if(errno == EINTR || errno == ECONNABORTED)
+      {
+        continue;
+      }
+
+      printError("accept");
+      break;
+    }
+
+    int exitPipe[2];
+    if(pipe2(exitPipe, O_CLOEXEC) != 0)
+    {
+      printError("pipe");
+      close(connection);
+      continue;
+    }
+
+    std::cout.flush();
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+      close(listener);
+      close(exitPipe[0]);
+      for(const auto& request : requests)
+      {
+        close(request.connection);
+        close(request.exitDescriptor);
+      }
+
+      handleConnection(connection, handler);
+    }
+
+    close(exitPipe[1]);
+    if(pid < 0)
+    {
+      printError("fork");
+      close(connection);
+      close(exitPipe[0]);
+      continue;
+    }
+
+    requests.push_back({pid, connection, exitPipe[0]});
+  }
+
+  close(listener);
+  unlink(servedPath);
+  return EXIT_FAILURE;
+}
+
+int RequestDaemon(const std::string& path, const std::vector<std::string>& envs, const std::vector<std::string>& args)
+{
+  sockaddr_un address;
+  if(!makeAddress(path, address))
+  {
+    return printError(path);
+  }
+
+  int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(connection < 0)
+  {
+    return printError("socket");
+  }
+
+  if(connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+  {
+    close(connection);
+    return printError(path);
+  }
+
+  std::string payload;
+  appendFields(payload, envFieldTag, envs);
+  appendFields(payload, argFieldTag, args);
+  payload.push_back('\0'); // Guarantees a non-empty first message to carry the descriptors
+
+  const int descriptors[forwardedDescriptorCount] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(descriptors))];
+  std::memset(control, 0, sizeof(control));
+  iovec io {payload.data(), payload.length()};
+  msghdr message {};
+  message.msg_iov        = &io;
+  message.msg_iovlen     = 1u;
+  message.msg_control    = control;
+  message.msg_controllen = sizeof(control);
+
+  cmsghdr* pHeader   = CMSG_FIRSTHDR(&message);
+  pHeader->cmsg_level = SOL_SOCKET;
+  pHeader->cmsg_type  = SCM_RIGHTS;
+  pHeader->cmsg_len   = CMSG_LEN(sizeof(descriptors));
+  std::memcpy(CMSG_DATA(pHeader), descriptors, sizeof(descriptors));
+
+  ssize_t count;
+  while((count = sendmsg(connection, &message, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+  if(count < 0 || !writeAll(connection, payload.data() + count, payload.length() - static_cast<std::size_t>(count)) || shutdown(connection, SHUT_WR) != 0)
+  {
+    close(connection);
+    return printError(path);
+  }
+
+  std::string response;
+  bool isReceived = readAll(connection, response);
+  close(connection);
+  if(!isReceived || response.length() != statusLength)
+  {
+    std::cerr << "*** Error: Daemon closed the connection without reporting a status" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const auto tag   = static_cast<unsigned char>(response[0u]);
+  const auto value = static_cast<unsigned char>(response[1u]);
+  if(tag == signaledStatusTag)
+  {
+    // Terminates the same way as the handler did, if the signal is not fatal the conventional shell status is returned
+    std::signal(value, SIG_DFL);
+    std::raise(value);
+    return 128 + value;
+  }
+
+  return value;
+}
@@ -0,0 +1,23 @@
+#ifndef __DAEMON_HPP__
+#define __DAEMON_HPP__
+
+#include <functional>
+#include <string>
+#include <vector>
+
+using DaemonRequestHandlerType = std::function<int(const std::vector<std::string>& envs, const std::vector<std::string>& args)>;
+
+/*
+ * Listens on a local Unix domain socket and never returns unless setting up the socket fails.
+ * Each connection is served by a forked child which inherits the already initialized state, takes over the stdin/stdout/stderr of the client
+ * and runs the handler with the environment variables (NAME=VALUE) and arguments sent by the client. The handler's return value is sent back as exit status.
+ */
+int ServeDaemon(const std::string& path, const DaemonRequestHandlerType& handler);
+
+/*
+ * Forwards the given environment variables (NAME=VALUE) and arguments along with stdin/stdout/stderr of the current process to a daemon and waits for
+ * its exit status.
+ */
+int RequestDaemon(const std::string& path, const std::vector<std::string>& envs, const std::vector<std::string>& args);
+
+#endif // __DAEMON_HPP__
@@ -0,0 +1,335 @@
+#include "Jit.hpp"
+#include "Setup.hpp"
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define TRTBL_JIT_SUPPORTED
+#endif
+
+enum class JitOperation
+{
+  Not,
+  And,
+  Or,
+  Xor,
+  Nand,
+  Nor,
+  Xnor,
+};
+
+// Machine operations backing the callbacks registered in InitTruthTable
+static const std::unordered_map<char, JitOperation> unaryOperationMap = {
+    {'!', JitOperation::Not},
+    {'~', JitOperation::Not},
+};
+
+static const std::unordered_map<std::string, JitOperation> binaryOperationMap = {
+    {"==", JitOperation::Xnor},
+    {"!=", JitOperation::Xor},
+    {"|", JitOperation::Or},
+    {"&", JitOperation::And},
+    {"^", JitOperation::Xor},
+    {"+", JitOperation::Or},
+    {"*", JitOperation::And},
+    {"/", JitOperation::Xor},
+};
+
+static const std::unordered_map<std::string, JitOperation> functionOperationMap = {
+    {"NOT", JitOperation::Not},
+    {"OR", JitOperation::Or},
+    {"AND", JitOperation::And},
+    {"XOR", JitOperation::Xor},
+    {"NOR", JitOperation::Nor},
+    {"NAND", JitOperation::Nand},
+    {"XNOR", JitOperation::Xnor},
+};
+
+// Scratch registers used as an operand stack: rax, rcx, rdx, rsi, r8, r9, r10, r11. rdi holds the variable array
+static const std::uint8_t stackRegisters[] = {0u, 1u, 2u, 6u, 8u, 9u, 10u, 11u};
+static const std::uint8_t variablesRegister = 7u;
+
+// Thrown internally when the expression uses anything the compiler does not handle, which makes Compile() fall back to the interpreter
+struct JitUnsupportedError
+{
+};
+
+class JitCompiler
+{
+  public:
+  explicit JitCompiler(const std::vector<const void*>& variables)
+  {
+    for(std::size_t i = 0u; i < variables.size(); i++)
+    {
+      m_Tokens[variables[i]] = {TokenType::Variable, JitOperation::Not, i, false};
+    }
+
+    for(const auto& i : defaultInitializedVariableCache)
+    {
+      m_Tokens[dynamic_cast<const void*>(i.second.get())] = {
+          TokenType::Constant, JitOperation::Not, 0u, i.second->As<DefaultValueType*>()->GetValue<DefaultArithmeticType>()};
+    }
+
+    addOperations(defaultUnaryOperatorCache, unaryOperationMap);
+    addOperations(defaultBinaryOperatorCache, binaryOperationMap);
+    addOperations(defaultFunctionCache, functionOperationMap);
+    if(defaultJuxtapositionOperator != nullptr)
+    {
+      m_Tokens[dynamic_cast<const void*>(defaultJuxtapositionOperator.get())] = {TokenType::Operation, JitOperation::And, 0u, false};
+    }
+  }
+
+  const std::vector<std::uint8_t>& Run(const std::vector<const void*>& tokens)
+  {
+    std::size_t depth = 0u;
+    for(const auto pToken : tokens)
+    {
+      auto iter = m_Tokens.find(pToken);
+      if(iter == m_Tokens.end())
+      {
+        throw JitUnsupportedError();
+      }
+
+      const auto& token = iter->second;
+      switch(token.type)
+      {
+        case TokenType::Variable:
+          emitLoad(getRegister(depth++), token.index);
+          break;
+        case TokenType::Constant:
+          emitConstant(getRegister(depth++), token.value);
+          break;
+        case TokenType::Operation:
+        {
+          const std::size_t operandCount = (token.operation == JitOperation::Not) ? 1u : 2u;
+          if(depth < operandCount)
+          {
+            throw JitUnsupportedError();
+          }
+
+          depth -= operandCount;
+          emitOperation(token.operation, depth++);
+          break;
+        }
+      }
+    }
+
+    if(depth != 1u)
+    {
+      throw JitUnsupportedError();
+    }
+
+    emitMove(0u, getRegister(0u));
+    m_Code.push_back(0xC3u); // ret
+    return m_Code;
+  }
+
+  private:
+  enum class TokenType
+  {
+    Variable,
+    Constant,
+    Operation,
+  };
+
+  struct TokenInfo
+  {
+    TokenType type;
+    JitOperation operation;
+    std::size_t index;
+    bool value;
+  };
+
+  // Only registered tokens with a known machine operation are mapped, unknown callbacks make the compilation fail
+  template<typename CacheType, typename OperationMapType>
+  void addOperations(const CacheType& cache, const OperationMapType& operationMap)
+  {
+    for(const auto& i : cache)
+    {
+      auto iter = operationMap.find(i.first);
+      if(iter != operationMap.end())
+      {
+        m_Tokens[dynamic_cast<const void*>(i.second.get())] = {TokenType::Operation, iter->second, 0u, false};
+      }
+    }
+  }
+
+  static std::uint8_t getRegister(std::size_t depth)
+  {
+    if(depth >= sizeof(stackRegisters))
+    {
+      throw JitUnsupportedError();
+    }
+
+    return stackRegisters[depth];
+  }
+
+  void emitImmediate32(std::int32_t value)
+  {
+    std::uint8_t bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    m_Code.insert(m_Code.end(), bytes, bytes + sizeof(bytes));
+  }
+
+  // mov reg, [rdi + index * 8]
+  void emitLoad(std::uint8_t reg, std::size_t index)
+  {
+    m_Code.push_back(static_cast<std::uint8_t>(0x48u | ((reg >> 3u) << 2u)));
+    m_Code.push_back(0x8Bu);
+    m_Code.push_back(static_cast<std::uint8_t>(0x80u | ((reg & 7u) << 3u) | variablesRegister));
+    emitImmediate32(static_cast<std::int32_t>(index * sizeof(std::uint64_t)));
+  }
+
+  // mov reg, imm32 (sign extended)
+  void emitConstant(std::uint8_t reg, bool value)
+  {
+    m_Code.push_back(static_cast<std::uint8_t>(0x48u | (reg >> 3u)));
+    m_Code.push_back(0xC7u);
+    m_Code.push_back(static_cast<std::uint8_t>(0xC0u | (reg & 7u)));
+    emitImmediate32(value ? -1 : 0);
+  }
+
+  // not reg
+  void emitNot(std::uint8_t reg)
+  {
+    m_Code.push_back(static_cast<std::uint8_t>(0x48u | (reg >> 3u)));
+    m_Code.push_back(0xF7u);
+    m_Code.push_back(static_cast<std::uint8_t>(0xD0u | (reg & 7u)));
+  }
+
+  // <opcode> dst, src (r/m64, r64 form)
+  void emitRegisterOperation(std::uint8_t opcode, std::uint8_t dst, std::uint8_t src)
+  {
+    m_Code.push_back(static_cast<std::uint8_t>(0x48u | ((src >> 3u) << 2u) | (dst >> 3u)));
+    m_Code.push_back(opcode);
+    m_Code.push_back(static_cast<std::uint8_t>(0xC0u | ((src & 7u) << 3u) | (dst & 7u)));
+  }
+
+  void emitMove(std::uint8_t dst, std::uint8_t src)
+  {
+    if(dst != src)
+    {
+      emitRegisterOperation(0x89u, dst, src);
+    }
+  }
+
+  void emitOperation(JitOperation operation, std::size_t depth)
+  {
+    const auto dst = getRegister(depth);
+    if(operation == JitOperation::Not)
+    {
+      emitNot(dst);
+      return;
+    }
+
+    const auto src = getRegister(depth + 1u);
+    switch(operation)
+    {
+      case JitOperation::And:
+      case JitOperation::Nand:
+        emitRegisterOperation(0x21u, dst, src);
+        break;
+      case JitOperation::Or:
+      case JitOperation::Nor:
+        emitRegisterOperation(0x09u, dst, src);
+        break;
+      default:
+        emitRegisterOperation(0x31u, dst, src);
+        break;
+    }
+
+    if(operation == JitOperation::Nand || operation == JitOperation::Nor || operation == JitOperation::Xnor)
+    {
+      emitNot(dst);
+    }
+  }
+
+  std::unordered_map<const void*, TokenInfo> m_Tokens;
+  std::vector<std::uint8_t> m_Code;
+};
+
+std::unique_ptr<JitExpression> JitExpression::Compile(const std::vector<const void*>& tokens, const std::vector<const void*>& variables)
+{
+#ifdef TRTBL_JIT_SUPPORTED
+  if(variables.size() > GetMaxVariableCount())
+  {
+    return nullptr;
+  }
+
+  std::vector<std::uint8_t> code;
+  try
+  {
+    JitCompiler compiler(variables);
+    code = compiler.Run(tokens);
+  }
+  catch(const JitUnsupportedError&)
+  {
+    return nullptr;
+  }
+
+  const auto pageSize   = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  const auto memorySize = ((code.size() + pageSize - 1u) / pageSize) * pageSize;
+  void* pMemory         = mmap(nullptr, memorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(pMemory == MAP_FAILED)
+  {
+    return nullptr;
+  }
+
+  std::memcpy(pMemory, code.data(), code.size());
+  if(mprotect(pMemory, memorySize, PROT_READ | PROT_EXEC) != 0)
+  {
+    munmap(pMemory, memorySize);
+    return nullptr;
+  }
+
+  return std::unique_ptr<JitExpression>(new JitExpression(pMemory, memorySize, variables.size()));
+#else
+  static_cast<void>(tokens);
+  static_cast<void>(variables);
+  return nullptr;
+#endif
+}
+
+JitExpression::JitExpression(void* pMemory, std::size_t memorySize, std::size_t variableCount)
+    : m_pMemory(pMemory)
+    , m_MemorySize(memorySize)
+    , m_Function(nullptr)
+    , m_VariableCount(variableCount)
+{
+  static_assert(sizeof(m_Function) == sizeof(m_pMemory));
+  std::memcpy(&m_Function, &m_pMemory, sizeof(m_Function));
+}
+
+JitExpression::~JitExpression()
+{
+#ifdef TRTBL_JIT_SUPPORTED
+  munmap(m_pMemory, m_MemorySize);
+#endif
+}
+
+std::uint64_t JitExpression::EvaluateBlock(std::uint64_t blockIndex) const
+{
+  // Bit n of pattern k is bit k of n, i.e. the value of the variable toggling every 2^k rows
+  static const std::uint64_t patterns[] = {
+      0xAAAAAAAAAAAAAAAAu,
+      0xCCCCCCCCCCCCCCCCu,
+      0xF0F0F0F0F0F0F0F0u,
+      0xFF00FF00FF00FF00u,
+      0xFFFF0000FFFF0000u,
+      0xFFFFFFFF00000000u,
+  };
+  static const std::size_t patternCount = sizeof(patterns) / sizeof(*patterns);
+
+  std::uint64_t variables[GetMaxVariableCount()];
+  for(std::size_t i = 0u; i < m_VariableCount; i++)
+  {
+    const auto bit = m_VariableCount - 1u - i;
+    variables[i]   = (bit < patternCount) ? patterns[bit] : (((blockIndex >> (bit - patternCount)) & 1u) != 0u ? ~std::uint64_t(0u) : std::uint64_t(0u));
+  }
+
+  return m_Function(variables);
+}
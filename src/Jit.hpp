@@ -0,0 +1,45 @@
+#ifndef __JIT_HPP__
+#define __JIT_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+ * An expression compiled to native x86-64 code which evaluates 64 consecutive truth table rows per call.
+ * Only the operators, functions and constants registered by InitTruthTable are supported.
+ */
+class JitExpression
+{
+  public:
+  using FunctionType = std::uint64_t (*)(const std::uint64_t* variables);
+
+  /*
+   * Compiles a parsed expression given in postfix order. Tokens and variables are identified by the address of their most derived object.
+   * Returns nullptr if any token is not one registered by InitTruthTable, or if the platform is not supported.
+   * The variables are given in column order, the last one toggles on every row.
+   */
+  static std::unique_ptr<JitExpression> Compile(const std::vector<const void*>& tokens, const std::vector<const void*>& variables);
+
+  /*
+   * Returns the results of rows [blockIndex * 64, blockIndex * 64 + 63], bit n corresponding to row blockIndex * 64 + n.
+   */
+  std::uint64_t EvaluateBlock(std::uint64_t blockIndex) const;
+
+  static constexpr std::size_t GetMaxVariableCount() { return 63u; }
+
+  JitExpression(const JitExpression&) = delete;
+  JitExpression& operator=(const JitExpression&) = delete;
+  ~JitExpression();
+
+  private:
+  JitExpression(void* pMemory, std::size_t memorySize, std::size_t variableCount);
+
+  void* m_pMemory;
+  std::size_t m_MemorySize;
+  FunctionType m_Function;
+  std::size_t m_VariableCount;
+};
+
+#endif // __JIT_HPP__
@@ -33,6 +33,8 @@ inline std::unordered_map<char, IUnaryOperatorToken*> defaultUnaryOperators;
 inline std::unordered_map<std::string, std::unique_ptr<BinaryOperatorToken>> defaultBinaryOperatorCache;
 inline std::unordered_map<std::string, IBinaryOperatorToken*> defaultBinaryOperators;
 
+inline std::unique_ptr<BinaryOperatorToken> defaultJuxtapositionOperator;
+
 inline std::unordered_map<std::string, std::unique_ptr<FunctionToken>> defaultFunctionCache;
 inline std::unordered_map<std::string, IFunctionToken*> defaultFunctions;
 
@@ -57,11 +59,15 @@ struct trtbl_options
   std::size_t opad_b;
   bool sort;
   int jpo_precedence;
+  bool jit;
+  std::size_t jit_check;
+  bool bulk;
 };
 
-const inline trtbl_options defaultOptions {"1", "0", ' ', '=', 1u, 1u, 4u, 1u, false, -1};
+const inline trtbl_options defaultOptions {"1", "0", ' ', '=', 1u, 1u, 4u, 1u, false, -1, false, 0u, false};
 inline trtbl_options options {};
 
 void InitTruthTable(ExpressionParserBase& instance);
+void InitJuxtaposition(ExpressionParserBase& instance);
 
 #endif // __SETUP_HPP__
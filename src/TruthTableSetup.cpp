@@ -139,7 +139,7 @@ static IValueToken* Function_And(const std::vector<IValueToken*>& args)
 
 static IValueToken* Function_Xor(const std::vector<IValueToken*>& args)
 {
-  return new DefaultValueType(args[0]->As<DefaultValueType*>()->GetValue<DefaultArithmeticType>() &
+  return new DefaultValueType(args[0]->As<DefaultValueType*>()->GetValue<DefaultArithmeticType>() ^
                               args[1]->As<DefaultValueType*>()->GetValue<DefaultArithmeticType>());
 }
 
@@ -163,18 +163,25 @@ static IValueToken* Function_Xnor(const std::vector<IValueToken*>& args)
 #endif // __REGION__FUNCTIONS__BITWISE
 #endif // __REGION__FUNCTIONS
 
-static std::unique_ptr<BinaryOperatorToken> juxtapositionOperator;
-
-void InitTruthTable(ExpressionParserBase& instance)
+void InitJuxtaposition(ExpressionParserBase& instance)
 {
   if(options.jpo_precedence != 0)
   {
-    juxtapositionOperator = std::make_unique<BinaryOperatorToken>("&", BinaryOperator_BitwiseAnd, 2 + options.jpo_precedence, Associativity::Left);
+    defaultJuxtapositionOperator = std::make_unique<BinaryOperatorToken>("&", BinaryOperator_BitwiseAnd, 2 + options.jpo_precedence, Associativity::Left);
+  }
+  else
+  {
+    defaultJuxtapositionOperator.reset();
   }
 
+  instance.SetJuxtapositionOperator(defaultJuxtapositionOperator.get());
+}
+
+void InitTruthTable(ExpressionParserBase& instance)
+{
+  InitJuxtaposition(instance);
   instance.SetOnParseNumberCallback(numberConverter);
   instance.SetOnUnknownIdentifierCallback(addNewVariable);
-  instance.SetJuxtapositionOperator(juxtapositionOperator.get());
 
   instance.SetUnaryOperators(&defaultUnaryOperators);
   instance.SetBinaryOperators(&defaultBinaryOperators);